@@ -35,9 +35,11 @@ int calculate_sswc(int argc, char **argv) {
     medoids[99] = 1;
     medoids[149] = 1;
 
-    float val = sswc(medoids, dataset, n_objects, n_attributes);
+    dist_metric metric = get_metric(METRIC_EUCLIDEAN, dataset, n_objects, n_attributes);
+    float val = sswc(medoids, dataset, n_objects, n_attributes, &metric);
     printf("sswc: %f\n", val);
 
+    free_metric(&metric);
     free(medoids);
     free(dataset);
     return 0;
@@ -47,7 +49,8 @@ int main(int argc, char **argv) {
     int n_objects, n_attributes;
 
     float *dataset = read_dataset("../datasets/iris.csv", &n_objects, &n_attributes);
-    float *dm = get_distance_matrix(dataset, n_objects, n_attributes, true);
+    dist_metric metric = get_metric(METRIC_SQEUCLIDEAN, dataset, n_objects, n_attributes);
+    packed_dm dm = get_packed_distance_matrix(dataset, n_objects, n_attributes, &metric, DM_FLOAT32);
 
 //    srand((unsigned int)time(NULL));  // seeds with the current time
 //    int *partition = randint(n_objects, 0, 2);
@@ -61,11 +64,12 @@ int main(int argc, char **argv) {
         }
     }
 
-    float dbcv_index = dbcv(partition, dm, n_objects, n_attributes);
+    float dbcv_index = dbcv(partition, &dm, n_objects, n_attributes);
     printf("dbcv: %f\n", dbcv_index);
 
     free(dataset);
-    free(dm);
+    free_packed_dm(&dm);
+    free_metric(&metric);
 
     return 0;
 }
\ No newline at end of file
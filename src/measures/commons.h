@@ -7,20 +7,43 @@
 
 #include <math.h>
 
+#include "metrics.h"
+#include "precision.h"
+
 /**
- * Calculates the euclidean distance between two data objects.
- * @param x1 First object
- * @param x2 Second object
- * @param n_attributes Number of predictive attributes for both objects
- * @param squared Whether to return a squared euclidean distance
- * @return The euclidean distance
+ * Gets the distance matrix between objects within a dataset, stored in a reduced-precision format.
+ *
+ * @param dataset A pointer to the first element in the dataset
+ * @param n_objects Number of objects within the dataset
+ * @param n_attributes Total number of attributes in the dataset
+ * @param metric The distance metric between objects
+ * @param storage One of the DM_* formats in which cells are stored
+ * @return A packed distance matrix with n_objects x n_objects cells.
  */
-float get_euclidean_distance(float *x1, float *x2, int n_attributes, bool squared) {
-    float distance = 0;
-    for(int n = 0; n < n_attributes; n++) {
-        distance += pow(x1[n] - x2[n], (float)2);
+packed_dm get_packed_distance_matrix(float *dataset, int n_objects, int n_attributes, dist_metric *metric, int storage) {
+    row_kernel distances = get_row_kernel(metric, n_attributes);
+    float *row = (float*)malloc(sizeof(float) * n_objects);
+
+    float max_dist = 0;
+    if(storage == DM_FLOAT16 || storage == DM_UINT16) {  // scale depends on the largest distance
+        for(int i = 0; i < n_objects; i++) {
+            distances(&dataset[(size_t)i * n_attributes], dataset, i, n_attributes, metric->weights, row);
+            for(int j = 0; j < i; j++) {
+                max_dist = fmaxf(max_dist, row[j]);
+            }
+        }
     }
-    return ((squared)*distance) + (!squared)*sqrtf(distance);
+
+    packed_dm matrix = alloc_packed_dm(n_objects, storage, max_dist);
+
+    for(int i = 0; i < n_objects; i++) {
+        distances(&dataset[(size_t)i * n_attributes], dataset, i + 1, n_attributes, metric->weights, row);
+        store_row(&matrix, i, 0, i + 1, row);
+    }
+    mirror_lower(&matrix);
+
+    free(row);
+    return matrix;
 }
 
 /**
@@ -33,50 +56,76 @@ float get_euclidean_distance(float *x1, float *x2, int n_attributes, bool square
  * @return A pointer to the first position of the distance matrix, which has size n_objects x n_objects.
  */
 float *get_distance_matrix(float *dataset, int n_objects, int n_attributes, bool squared) {
-    float *matrix = (float*)malloc(sizeof(float) * n_objects * n_objects);
+    dist_metric metric = {squared ? METRIC_SQEUCLIDEAN : METRIC_EUCLIDEAN, NULL};
+    return (float*)get_packed_distance_matrix(dataset, n_objects, n_attributes, &metric, DM_FLOAT32).data;
+}
 
-    for(int i = 0; i < n_objects; i++) {
-        for(int j = 0; j <= i; j++) {
-            float dist = get_euclidean_distance(
-                    &dataset[i * n_attributes],
-                    &dataset[j * n_attributes],
-                    n_attributes,
-                    squared
-            );
-            matrix[i * n_objects + j] = dist;
-            matrix[j * n_objects + i] = dist;
+/**
+ * Copies the medoids to a contiguous array, so that distances to all of them can be computed in a single row.
+ *
+ * @param medoids A truth array where zeros are default objects and ones the medoids
+ * @param dataset A pointer to the first position of the dataset
+ * @param n_objects Number of objects in the dataset
+ * @param n_attributes Total number of attributes in the dataset
+ * @param indices Output: index in the dataset of each medoid. Must be freed by the caller
+ * @param n_medoids Output: number of medoids
+ * @return A pointer to the first position of the medoids, which has size n_medoids x n_attributes
+ */
+float *gather_medoids(int *medoids, float *dataset, int n_objects, int n_attributes, int **indices, int *n_medoids) {
+    *n_medoids = 0;
+    for(int j = 0; j < n_objects; j++) {
+        *n_medoids += (medoids[j] == 1);
+    }
+
+    float *points = (float*)malloc(sizeof(float) * *n_medoids * n_attributes);
+    *indices = (int*)malloc(sizeof(int) * *n_medoids);
+
+    int counter = 0;
+    for(int j = 0; j < n_objects; j++) {
+        if(medoids[j] == 1) {
+            memcpy(&points[counter * n_attributes], &dataset[j * n_attributes], sizeof(float) * n_attributes);
+            (*indices)[counter] = j;
+            counter += 1;
         }
     }
-    return matrix;
+    return points;
 }
 
 /**
  * From a set of medoids, gets the partition.
  *
  * @param medoids A truth array where zeros are default objects and ones the medoids
- * @param dm A pointer to the first position in the distance matrix
  * @param dataset A pointer to the first position of the dataset
  * @param n_objects Number of objects in the dataset
  * @param n_attributes Total number of attributes in the dataset
+ * @param metric The distance metric between objects
  * @return A pointer to the first position of the partition array, which has size n_objects
  */
-int *get_partition(int *medoids, float *dm, float *dataset, int n_objects, int n_attributes) {
+int *get_partition(int *medoids, float *dataset, int n_objects, int n_attributes, dist_metric *metric) {
     int *partition = (int*)malloc(sizeof(int) * n_objects);
 
+    int n_medoids, *indices;
+    float *points = gather_medoids(medoids, dataset, n_objects, n_attributes, &indices, &n_medoids);
+    float *dists = (float*)malloc(sizeof(float) * n_medoids);
+    row_kernel distances = get_row_kernel(metric, n_attributes);
+
     for(int i = 0; i < n_objects; i++) {
+        distances(&dataset[i * n_attributes], points, n_medoids, n_attributes, metric->weights, dists);
+
         float closest_dist = INFINITY; // sets to infinity
         int closest_index = -1; // sets to infinity
-        for(int j = 0; j < n_objects; j++) {
-            if(medoids[j] == 1) {
-                if(dm[i * n_objects + j] < closest_dist) {
-                    closest_dist = dm[i * n_objects + j];
-                    closest_index = j;
-                }
+        for(int j = 0; j < n_medoids; j++) {
+            if(dists[j] < closest_dist) {
+                closest_dist = dists[j];
+                closest_index = indices[j];
             }
-            partition[i] = closest_index;
         }
+        partition[i] = closest_index;
     }
-    free(dm);
+
+    free(dists);
+    free(indices);
+    free(points);
     return partition;
 }
 
@@ -1,6 +1,8 @@
 #ifndef CLUSTERING_DBCV_H
 #define CLUSTERING_DBCV_H
 
+#include "commons.h"
+
 #define MST_FIELDS 3
 
 #define NEIGHBOR_INDEX 0
@@ -21,20 +23,22 @@
  * </ul>
  *
  * @param partition An array with the cluster assignment for each object
- * @param dm A pointer to the first position of a distance matrix
+ * @param dm A packed distance matrix
  * @param n_objects Number of objects in the dataset
  * @param n_attributes Number of attributes in the dataset
  * @return An array with the a_pts_coredist for each and every object in the dataset
  */
-float *a_pts_coredist(int *partition, float *dm, int n_objects, int n_attributes) {
+float *a_pts_coredist(int *partition, packed_dm *dm, int n_objects, int n_attributes) {
     float *apts = (float*)malloc(sizeof(float) * n_objects);
+    float *buffer = (float*)malloc(sizeof(float) * n_objects);
 
     for(int i = 0; i < n_objects; i++) {
+        const float *row = load_row(dm, i, buffer);
         int cluster_size = 0;
         float _sum = 0;
         for(int j = 0; j < n_objects; j++) {
             if(partition[i] == partition[j]) {
-                float dist = dm[i * n_objects + j];
+                float dist = row[j];
                 if(dist > 0) {
                     _sum += powf(1 / dist, (float)n_attributes);
                 }
@@ -46,6 +50,7 @@ float *a_pts_coredist(int *partition, float *dm, int n_objects, int n_attributes
         apts[i] = powf(_sum, -1/(float)n_attributes);
     }
 
+    free(buffer);
     return apts;
 }
 
@@ -71,18 +76,29 @@ float mreach_dist(float apts_1, float apts_2, float sqd_dist) {
  * @param apts The core distance for each and every object in the dataset
  * @param sqd_dm The matrix of squared euclidean distance between data objects
  * @param n_objects Number of objects in the dataset
- * @return
+ * @return A packed matrix of mutual reachability distances, in the same format as sqd_dm
  */
-float *mreach_mat(float *apts, float *sqd_dm, int n_objects) {
-    float *matrix = (float*)malloc(sizeof(float) * n_objects * n_objects);
+packed_dm mreach_mat(float *apts, packed_dm *sqd_dm, int n_objects) {
+    float max_apts = 0;
+    for(int i = 0; i < n_objects; i++) {
+        max_apts = fmaxf(max_apts, apts[i]);
+    }
+    packed_dm matrix = alloc_packed_dm(n_objects, sqd_dm->storage, fmaxf(max_apts, packed_dm_bound(sqd_dm)));
+
+    float *buffer = (float*)malloc(sizeof(float) * n_objects);
+    float *mreach_row = (float*)malloc(sizeof(float) * n_objects);
 
     for(int i = 0; i < n_objects; i++) {
+        const float *row = load_row(sqd_dm, i, buffer);
         for(int j = 0; j <= i; j++) {
-            matrix[i * n_objects + j] = mreach_dist(apts[i], apts[j], sqd_dm[i * n_objects + j]);
-            matrix[j * n_objects + i] = matrix[i * n_objects + j];
+            mreach_row[j] = mreach_dist(apts[i], apts[j], row[j]);
         }
+        store_row(&matrix, i, 0, i + 1, mreach_row);
     }
+    mirror_lower(&matrix);
 
+    free(mreach_row);
+    free(buffer);
     return matrix;
 }
 
@@ -93,6 +109,7 @@ float *mreach_mat(float *apts, float *sqd_dm, int n_objects) {
  * @param dataset A pointer to the first position of a dataset
  * @param n_objects Number of objects in the dataset
  * @param n_attributes Number of attributes in the dataset
+ * @param metric The distance metric between objects
  * @return A pointer to the first position of the minimum spanning tree, which is
  *  a matrix with n_objects * 3 positions:
  *  <ul>
@@ -102,9 +119,11 @@ float *mreach_mat(float *apts, float *sqd_dm, int n_objects) {
  *    linked to only another object).</li>
  *  </ul>
  */
-float *prim_dat(float *dataset, int n_objects, int n_attributes) {
+float *prim_dat(float *dataset, int n_objects, int n_attributes, dist_metric *metric) {
     // closest neighbor index, closest neighbor distance, and degree of the object
     float *mst = (float*)malloc(sizeof(float) * (n_objects * MST_FIELDS));
+    float *row = (float*)malloc(sizeof(float) * n_objects);
+    row_kernel distances = get_row_kernel(metric, n_attributes);
     for(int n = 0; n < n_objects; n++) {
         mst[n * MST_FIELDS + NEIGHBOR_INDEX] = INFINITY;
         mst[n * MST_FIELDS + NEIGHBOR_DISTANCE] = INFINITY;
@@ -116,15 +135,11 @@ float *prim_dat(float *dataset, int n_objects, int n_attributes) {
     int counter = 0;
     while(counter < n_objects - 1) {
         float dist = INFINITY;
+        distances(&dataset[v * n_attributes], dataset, n_objects, n_attributes, metric->weights, row);
 
         for(int w = 0; w < n_objects; w++) {
             if((w != v) && (mst[w * MST_FIELDS + SELF_DEGREE] == 0)) {
-                float weight = get_euclidean_distance(
-                        &dataset[v * n_attributes],
-                        &dataset[w * n_attributes],
-                        n_attributes,
-                        true
-                );
+                float weight = row[w];
                 if(mst[w * MST_FIELDS + NEIGHBOR_DISTANCE] > weight) {
                     mst[w * MST_FIELDS + NEIGHBOR_DISTANCE] = weight;
                     mst[w * MST_FIELDS + NEIGHBOR_INDEX] = v;
@@ -141,13 +156,14 @@ float *prim_dat(float *dataset, int n_objects, int n_attributes) {
 
         v = next_v;
     }
+    free(row);
     return mst;
 }
 
 /**
  * Finds the Minimum Spanning Tree of a dataset using the Prim algorithm.
  *
- * @param dm A pointer to the first position of a distance matrix
+ * @param dm A packed distance matrix
  * @param n_objects Number of objects in the dataset
  * @return A pointer to the first position of the minimum spanning tree, which is
  *  a matrix with n_objects * 3 positions:
@@ -158,9 +174,10 @@ float *prim_dat(float *dataset, int n_objects, int n_attributes) {
  *    linked to only another object).</li>
  *  </ul>
  */
-float *prim_mat(float *dm, int n_objects) {
+float *prim_mat(packed_dm *dm, int n_objects) {
     // closest neighbor index, closest neighbor distance, and degree of the object
     float *mst = (float*)malloc(sizeof(float) * (n_objects * MST_FIELDS));
+    float *buffer = (float*)malloc(sizeof(float) * n_objects);
     for(int n = 0; n < n_objects; n++) {
         mst[n * MST_FIELDS + NEIGHBOR_INDEX] = INFINITY;
         mst[n * MST_FIELDS + NEIGHBOR_DISTANCE] = INFINITY;
@@ -172,10 +189,11 @@ float *prim_mat(float *dm, int n_objects) {
     int counter = 0;
     while(counter < n_objects - 1) {
         float dist = INFINITY;
+        const float *row = load_row(dm, v, buffer);
 
         for(int w = 0; w < n_objects; w++) {
             if((w != v) && (mst[w * MST_FIELDS + SELF_DEGREE] == 0)) {
-                float weight = dm[v * n_objects + w];
+                float weight = row[w];
                 if(mst[w * MST_FIELDS + NEIGHBOR_DISTANCE] > weight) {
                     mst[w * MST_FIELDS + NEIGHBOR_DISTANCE] = weight;
                     mst[w * MST_FIELDS + NEIGHBOR_INDEX] = v;
@@ -192,6 +210,7 @@ float *prim_mat(float *dm, int n_objects) {
 
         v = next_v;
     }
+    free(buffer);
     return mst;
 }
 
@@ -232,9 +251,10 @@ int get_group_size(int *partition, int n_objects, int cluster) {
     return group_size;
 }
 
-float *prim_cls(float *dm, int *partition, int n_objects, int *labels, int n_groups) {
+float *prim_cls(packed_dm *dm, int *partition, int n_objects, int *labels, int n_groups) {
     // closest neighbor index, closest neighbor distance, and degree of the object
     float *mst = (float*)malloc(sizeof(float) * (n_objects * MST_FIELDS));
+    float *buffer = (float*)malloc(sizeof(float) * n_objects);
     for(int n = 0; n < n_objects; n++) {
         mst[n * MST_FIELDS + NEIGHBOR_INDEX] = INFINITY;
         mst[n * MST_FIELDS + NEIGHBOR_DISTANCE] = INFINITY;
@@ -258,11 +278,12 @@ float *prim_cls(float *dm, int *partition, int n_objects, int *labels, int n_gro
 
         while(counter < group_size - 1) {
             float dist = INFINITY;
+            const float *row = load_row(dm, v, buffer);
 
             for(int w = 0; w < n_objects; w++) {
                 if((partition[w] == partition[v]) && (partition[w] == labels[c]) &&
                         (w != v) && (mst[w * MST_FIELDS + SELF_DEGREE] == 0)) {
-                    float weight = dm[v * n_objects + w];
+                    float weight = row[w];
                     if(mst[w * MST_FIELDS + NEIGHBOR_DISTANCE] > weight) {
                         mst[w * MST_FIELDS + NEIGHBOR_DISTANCE] = weight;
                         mst[w * MST_FIELDS + NEIGHBOR_INDEX] = v;
@@ -281,11 +302,13 @@ float *prim_cls(float *dm, int *partition, int n_objects, int *labels, int n_gro
         }
 
     }
+    free(buffer);
     return mst;
 }
 
-float *validity_of_cluster(float *mreach_mst, float *mreach_matrix, int *partition, int n_objects, int *labels, int n_groups) {
+float *validity_of_cluster(float *mreach_mst, packed_dm *mreach_matrix, int *partition, int n_objects, int *labels, int n_groups) {
     float *vc = (float*)malloc(sizeof(float) * n_groups);
+    float *buffer = (float*)malloc(sizeof(float) * n_objects);
 
     for(int c = 0; c < n_groups; c++) {
         float dsc = -INFINITY;
@@ -298,6 +321,7 @@ float *validity_of_cluster(float *mreach_mst, float *mreach_matrix, int *partiti
             if((mreach_mst[i * MST_FIELDS + SELF_DEGREE] < min_degree) || (partition[i] != labels[c])) {
                 continue;
             }
+            const float *row = load_row(mreach_matrix, i, buffer);
 
             for(int j = 0; j < n_objects; j++) {  // inner object
                 if(mreach_mst[j * MST_FIELDS + SELF_DEGREE] < min_degree) {
@@ -305,8 +329,8 @@ float *validity_of_cluster(float *mreach_mst, float *mreach_matrix, int *partiti
                 }
 
                 if(partition[i] != partition[j]) {
-                    if(mreach_matrix[i * n_objects + j] < dspc) {  // minimum distance between two clusters
-                        dspc = mreach_matrix[i * n_objects + j];
+                    if(row[j] < dspc) {  // minimum distance between two clusters
+                        dspc = row[j];
                     }
                 } else if( // maximum distance between two same-cluster objects
                         (mreach_mst[i * MST_FIELDS + NEIGHBOR_INDEX] == j) &&
@@ -328,20 +352,21 @@ float *validity_of_cluster(float *mreach_mst, float *mreach_matrix, int *partiti
             vc[c] = (dspc - dsc) / fmaxf(dspc, dsc);
         }
     }
+    free(buffer);
     return vc;
 }
 
 
-float dbcv(int *partition, float *dm, int n_objects, int n_attributes) {
+float dbcv(int *partition, packed_dm *dm, int n_objects, int n_attributes) {
     float *apts = a_pts_coredist(partition, dm, n_objects, n_attributes);
-    float *mreach_matrix = mreach_mat(apts, dm, n_objects);
+    packed_dm mreach_matrix = mreach_mat(apts, dm, n_objects);
 
     int *group_size = (int*)malloc(sizeof(int) * n_objects);
     int n_groups, *labels = get_labels(partition, n_objects, &n_groups, group_size);
 
-    float *mreach_mst = prim_cls(mreach_matrix, partition, n_objects, labels, n_groups);
+    float *mreach_mst = prim_cls(&mreach_matrix, partition, n_objects, labels, n_groups);
 
-    float *vc = validity_of_cluster(mreach_mst, mreach_matrix, partition, n_objects, labels, n_groups);
+    float *vc = validity_of_cluster(mreach_mst, &mreach_matrix, partition, n_objects, labels, n_groups);
 
     float dbcv_index = 0;
     for(int c = 0; c < n_groups; c++) {
@@ -349,7 +374,7 @@ float dbcv(int *partition, float *dm, int n_objects, int n_attributes) {
     }
 
     free(group_size);
-    free(mreach_matrix);
+    free_packed_dm(&mreach_matrix);
     free(mreach_mst);
     free(labels);
     free(apts);
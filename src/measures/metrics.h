@@ -0,0 +1,177 @@
+#ifndef CLUSTERING_METRICS_H
+#define CLUSTERING_METRICS_H
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define METRIC_EUCLIDEAN 0
+#define METRIC_SQEUCLIDEAN 1
+#define METRIC_MANHATTAN 2
+#define METRIC_COSINE 3
+#define METRIC_SEUCLIDEAN 4
+#define METRIC_SQSEUCLIDEAN 5
+
+#define N_METRICS 6
+
+/**
+ * A distance metric between data objects.
+ *
+ * Squared and unsquared variants are distinct metrics, so that squaredness is settled at compile time.
+ */
+typedef struct {
+    int kind;  // one of the METRIC_* values
+    float *weights;  // METRIC_SEUCLIDEAN and METRIC_SQSEUCLIDEAN: inverse of the variance of each attribute
+} dist_metric;
+
+/**
+ * Computes the distances from one object to n_points contiguous objects, writing them to out.
+ */
+typedef void (*row_kernel)(const float *x, const float *points, int n_points, int n_attributes,
+                           const float *weights, float *out);
+
+static inline float sqeuclidean_pair(const float *x1, const float *x2, int n_attributes, const float *weights) {
+    float distance = 0;
+    for(int n = 0; n < n_attributes; n++) {
+        float diff = x1[n] - x2[n];
+        distance += diff * diff;
+    }
+    return distance;
+}
+
+static inline float euclidean_pair(const float *x1, const float *x2, int n_attributes, const float *weights) {
+    return sqrtf(sqeuclidean_pair(x1, x2, n_attributes, weights));
+}
+
+static inline float manhattan_pair(const float *x1, const float *x2, int n_attributes, const float *weights) {
+    float distance = 0;
+    for(int n = 0; n < n_attributes; n++) {
+        distance += fabsf(x1[n] - x2[n]);
+    }
+    return distance;
+}
+
+/*
+ * One minus the cosine of the angle between both objects, clamped at zero against rounding for nearly parallel
+ * objects. A null object is at distance one from every other object, and at distance zero from another null object,
+ * so the diagonal stays zero.
+ */
+static inline float cosine_pair(const float *x1, const float *x2, int n_attributes, const float *weights) {
+    float dot = 0, norm1 = 0, norm2 = 0;
+    for(int n = 0; n < n_attributes; n++) {
+        dot += x1[n] * x2[n];
+        norm1 += x1[n] * x1[n];
+        norm2 += x2[n] * x2[n];
+    }
+    // plain selects rather than fmaxf, which keeps NaN semantics and stops the row loop from vectorizing
+    float norm = sqrtf(norm1 * norm2);
+    float distance = 1 - dot / ((norm > FLT_MIN) ? norm : FLT_MIN);
+    return ((distance > 0) & (norm1 + norm2 > 0)) ? distance : 0;
+}
+
+static inline float sqseuclidean_pair(const float *x1, const float *x2, int n_attributes, const float *weights) {
+    float distance = 0;
+    for(int n = 0; n < n_attributes; n++) {
+        float diff = x1[n] - x2[n];
+        distance += diff * diff * weights[n];
+    }
+    return distance;
+}
+
+static inline float seuclidean_pair(const float *x1, const float *x2, int n_attributes, const float *weights) {
+    return sqrtf(sqseuclidean_pair(x1, x2, n_attributes, weights));
+}
+
+/*
+ * Defines a row kernel for a pair distance. When dims is a literal the kernel only serves datasets with that many
+ * attributes, and the attribute loop is fully unrolled.
+ */
+#define DEFINE_ROW_KERNEL(name, pair, dims) \
+    void name(const float *x, const float *points, int n_points, int n_attributes, \
+              const float *weights, float *out) { \
+        for(int j = 0; j < n_points; j++) { \
+            out[j] = pair(x, &points[j * (dims)], (dims), weights); \
+        } \
+    }
+
+#define DEFINE_METRIC_KERNELS(metric) \
+    DEFINE_ROW_KERNEL(metric##_row, metric##_pair, n_attributes) \
+    DEFINE_ROW_KERNEL(metric##_row_2, metric##_pair, 2) \
+    DEFINE_ROW_KERNEL(metric##_row_3, metric##_pair, 3) \
+    DEFINE_ROW_KERNEL(metric##_row_4, metric##_pair, 4)
+
+#define METRIC_KERNELS(metric) {metric##_row, metric##_row_2, metric##_row_3, metric##_row_4}
+
+DEFINE_METRIC_KERNELS(euclidean)
+DEFINE_METRIC_KERNELS(sqeuclidean)
+DEFINE_METRIC_KERNELS(manhattan)
+DEFINE_METRIC_KERNELS(cosine)
+DEFINE_METRIC_KERNELS(seuclidean)
+DEFINE_METRIC_KERNELS(sqseuclidean)
+
+/**
+ * Picks the row kernel specialized for a metric and a number of attributes. Callers resolve the kernel once
+ * and then call it once per row, so there is no dispatch per pair of objects.
+ *
+ * Exits with an error if the metric is not one of the METRIC_* values.
+ *
+ * @param metric The distance metric
+ * @param n_attributes Number of attributes in the dataset
+ * @return The row kernel
+ */
+row_kernel get_row_kernel(dist_metric *metric, int n_attributes) {
+    static const row_kernel kernels[N_METRICS][4] = {
+            METRIC_KERNELS(euclidean),
+            METRIC_KERNELS(sqeuclidean),
+            METRIC_KERNELS(manhattan),
+            METRIC_KERNELS(cosine),
+            METRIC_KERNELS(seuclidean),
+            METRIC_KERNELS(sqseuclidean)
+    };
+    if(metric->kind < 0 || metric->kind >= N_METRICS) {
+        fprintf(stderr, "Error: unknown distance metric %d\n", metric->kind);
+        exit(EXIT_FAILURE);
+    }
+    int fixed = (n_attributes >= 2 && n_attributes <= 4) ? n_attributes - 1 : 0;
+    return kernels[metric->kind][fixed];
+}
+
+/**
+ * Builds a distance metric for a dataset.
+ *
+ * @param kind One of the METRIC_* values
+ * @param dataset A pointer to the first position of the dataset. Only read by standardized euclidean metrics,
+ *  which weight each attribute by the inverse of its sample variance. Constant attributes get weight zero.
+ * @param n_objects Number of objects in the dataset
+ * @param n_attributes Number of attributes in the dataset
+ * @return The distance metric. Must be released with free_metric
+ */
+dist_metric get_metric(int kind, float *dataset, int n_objects, int n_attributes) {
+    dist_metric metric = {kind, NULL};
+
+    if(kind == METRIC_SEUCLIDEAN || kind == METRIC_SQSEUCLIDEAN) {
+        metric.weights = (float*)malloc(sizeof(float) * n_attributes);
+        for(int k = 0; k < n_attributes; k++) {
+            double mean = 0, variance = 0;
+            for(int i = 0; i < n_objects; i++) {
+                mean += dataset[i * n_attributes + k];
+            }
+            mean /= n_objects;
+            for(int i = 0; i < n_objects; i++) {
+                double diff = dataset[i * n_attributes + k] - mean;
+                variance += diff * diff;
+            }
+            variance /= (n_objects > 1) ? n_objects - 1 : 1;
+            metric.weights[k] = (variance > 0) ? (float)(1 / variance) : 0;
+        }
+    }
+    return metric;
+}
+
+void free_metric(dist_metric *metric) {
+    free(metric->weights);
+    metric->weights = NULL;
+}
+
+#endif //CLUSTERING_METRICS_H
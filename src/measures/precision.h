@@ -0,0 +1,403 @@
+#ifndef CLUSTERING_PRECISION_H
+#define CLUSTERING_PRECISION_H
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DM_F16C_KERNEL
+#include <immintrin.h>
+#endif
+
+#define DM_FLOAT32 0
+#define DM_FLOAT16 1
+#define DM_BFLOAT16 2
+#define DM_UINT16 3
+
+#define DM_FLOAT16_MAX 65504
+#define DM_UINT16_SHIFT 12  // 23 float mantissa bits minus 11 code mantissa bits
+#define DM_UINT16_BIAS 96u  // float exponent of the lowest code exponent
+
+/**
+ * A square distance matrix whose cells are stored in one of the DM_* formats:
+ * <ul>
+ * <li>DM_FLOAT32: plain single precision, rows are read in place;</li>
+ * <li>DM_FLOAT16: IEEE half precision of the value divided by scale, a power of two that brings the largest value
+ *   just under 65504;</li>
+ * <li>DM_BFLOAT16: the upper 16 bits of a float, with round-to-nearest-even;</li>
+ * <li>DM_UINT16: log-companded code of the value divided by scale, for non-negative matrices. See float_to_ucode.</li>
+ * </ul>
+ * Consumers widen one row at a time to float through load_row, so arithmetic is always carried in float.
+ */
+typedef struct {
+    void *data;  // n_objects x n_objects cells, row-major
+    int storage;  // one of the DM_* formats
+    int n_objects;  // number of rows (and columns) of the matrix
+    float scale;  // DM_FLOAT16 and DM_UINT16: cells are decoded and then multiplied by scale
+} packed_dm;
+
+typedef union {
+    uint32_t u;
+    float f;
+} float_bits;
+
+/**
+ * Converts a float to a half precision float, rounding to nearest even.
+ *
+ * @param value The value to convert
+ * @return The bits of the half precision float
+ */
+uint16_t float_to_half(float value) {
+    const uint32_t f32_infinity = 255u << 23;
+    const uint32_t f16_overflow = (127u + 16u) << 23;
+    float_bits denorm_magic = {((127u - 15u) + (23u - 10u) + 1u) << 23};
+
+    float_bits f = {0};
+    f.f = value;
+    uint32_t sign = f.u & 0x80000000u;
+    f.u ^= sign;
+
+    uint16_t o;
+    if(f.u > f32_infinity) {
+        o = 0x7e00;  // NaN
+    } else if(f.u >= f16_overflow) {
+        o = (uint16_t)((f.u == f32_infinity) ? 0x7c00 : 0x7bff);
+    } else if(f.u < (113u << 23)) {  // subnormal or zero in half precision
+        f.f += denorm_magic.f;
+        o = (uint16_t)(f.u - denorm_magic.u);
+    } else {
+        uint32_t mant_odd = (f.u >> 13) & 1;
+        f.u += ((uint32_t)(15 - 127) << 23) + 0xfff;
+        f.u += mant_odd;
+        o = (uint16_t)(f.u >> 13);
+        if(o > 0x7bff) {
+            o = 0x7bff;  // rounded up past the largest finite half
+        }
+    }
+    return (uint16_t)(o | (sign >> 16));
+}
+
+/**
+ * Converts a half precision float to a float. Branch-free, so that row loops over it vectorize.
+ *
+ * @param h The bits of the half precision float
+ * @return The float value
+ */
+float half_to_float(uint16_t h) {
+    uint32_t exp_mant = h & 0x7fffu;
+    float_bits f = {exp_mant << 13};
+    f.f *= 0x1.0p112f;  // rebias exponent; also handles subnormals
+    f.u |= (uint32_t)(exp_mant >= 0x7c00u) * 0x7f800000u;  // infinity and NaN
+    f.u |= (uint32_t)(h & 0x8000u) << 16;
+    return f.f;
+}
+
+/**
+ * Converts a float to a bfloat16, rounding to nearest even.
+ *
+ * @param value The value to convert
+ * @return The bits of the bfloat16
+ */
+uint16_t float_to_bfloat16(float value) {
+    float_bits f = {0};
+    f.f = value;
+    if(isnan(value)) {
+        return (uint16_t)((f.u >> 16) | 0x40);
+    }
+    return (uint16_t)((f.u + 0x7fffu + ((f.u >> 16) & 1)) >> 16);
+}
+
+/**
+ * Converts a bfloat16 to a float.
+ *
+ * @param b The bits of the bfloat16
+ * @return The float value
+ */
+float bfloat16_to_float(uint16_t b) {
+    float_bits f = {(uint32_t)b << 16};
+    return f.f;
+}
+
+/**
+ * Converts a non-negative float to a 16-bit log-companded code: 5 exponent bits and 11 mantissa bits, so that values
+ * in the 32 octaves below 2 keep a relative precision of 2^-12. Code zero is reserved for zero; positive values below
+ * the smallest code are rounded up to it, and are never mistaken for duplicates.
+ *
+ * @param value The value to convert, already divided by the matrix scale
+ * @return The code
+ */
+uint16_t float_to_ucode(float value) {
+    const uint32_t zero_bits = DM_UINT16_BIAS << 23;
+
+    if(!(value > 0)) {
+        return 0;  // zero, negative or NaN
+    }
+    float_bits f = {0};
+    f.f = value;
+    if(f.u <= zero_bits + (1u << DM_UINT16_SHIFT)) {
+        return 1;
+    }
+    uint32_t u = f.u - zero_bits;
+    u += (1u << (DM_UINT16_SHIFT - 1)) - 1 + ((u >> DM_UINT16_SHIFT) & 1);  // round to nearest even
+    u >>= DM_UINT16_SHIFT;
+    return (uint16_t)(u > 0xffff ? 0xffff : u);
+}
+
+/**
+ * Converts a log-companded code to a float. Branch-free, so that row loops over it vectorize.
+ *
+ * @param q The code
+ * @return The float value, still to be multiplied by the matrix scale
+ */
+float ucode_to_float(uint16_t q) {
+    float_bits f = {((uint32_t)q << DM_UINT16_SHIFT) + (DM_UINT16_BIAS << 23)};
+    f.u &= -(uint32_t)(q != 0);
+    return f.f;
+}
+
+/**
+ * Size in bytes of a single cell of the matrix.
+ *
+ * @param storage One of the DM_* formats
+ * @return The size of a cell
+ */
+size_t dm_cell_size(int storage) {
+    return storage == DM_FLOAT32 ? sizeof(float) : sizeof(uint16_t);
+}
+
+/**
+ * Allocates a packed distance matrix. Cells are left uninitialized.
+ *
+ * Exits with an error when a DM_FLOAT16 or DM_UINT16 matrix is requested with a non-finite max_value, since no scale
+ * can represent it.
+ *
+ * @param n_objects Number of rows (and columns) of the matrix
+ * @param storage One of the DM_* formats
+ * @param max_value Largest value that will be stored. Used by DM_FLOAT16 and DM_UINT16 to set the scale
+ * @return The packed distance matrix
+ */
+packed_dm alloc_packed_dm(int n_objects, int storage, float max_value) {
+    packed_dm dm;
+    dm.storage = storage;
+    dm.n_objects = n_objects;
+    dm.scale = 1;
+
+    if((storage == DM_FLOAT16 || storage == DM_UINT16) && !isfinite(max_value)) {
+        fprintf(stderr, "Error: cannot scale a reduced-precision matrix to a largest value of %f\n", max_value);
+        exit(EXIT_FAILURE);
+    }
+    if(max_value > 0) {
+        if(storage == DM_FLOAT16) {
+            int exponent;
+            frexpf(max_value / DM_FLOAT16_MAX, &exponent);
+            dm.scale = ldexpf(1, exponent);
+        } else if(storage == DM_UINT16) {
+            dm.scale = max_value / ucode_to_float(0xffff);
+        }
+    }
+
+    dm.data = malloc(dm_cell_size(storage) * n_objects * n_objects);
+    return dm;
+}
+
+void free_packed_dm(packed_dm *dm) {
+    free(dm->data);
+    dm->data = NULL;
+}
+
+/**
+ * Largest value that a packed matrix can represent, as an upper bound on its cells.
+ *
+ * @param dm A packed distance matrix
+ * @return The upper bound
+ */
+float packed_dm_bound(packed_dm *dm) {
+    switch(dm->storage) {
+        case DM_FLOAT16:
+            return dm->scale * DM_FLOAT16_MAX;
+        case DM_UINT16:
+            return dm->scale * ucode_to_float(0xffff);
+        default:
+            return INFINITY;
+    }
+}
+
+#ifdef DM_F16C_KERNEL
+/**
+ * Widens n half precision floats and multiplies them by scale, eight at a time with F16C. Built for that target
+ * regardless of compiler flags; only call it when cpu_has_f16c holds.
+ */
+__attribute__((target("avx,f16c")))
+void load_half_row_f16c(const uint16_t *src, float *dst, int n, float scale) {
+    __m256 factor = _mm256_set1_ps(scale);
+    int j = 0;
+    for(; j + 8 <= n; j += 8) {
+        __m256 values = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)&src[j]));
+        _mm256_storeu_ps(&dst[j], _mm256_mul_ps(values, factor));
+    }
+    for(; j < n; j++) {
+        dst[j] = half_to_float(src[j]) * scale;
+    }
+}
+
+/**
+ * Multiplies count floats by inv_scale and narrows them to half precision, eight at a time with F16C. Finite values
+ * beyond the largest half saturate to it, as in float_to_half. Built for that target regardless of compiler flags;
+ * only call it when cpu_has_f16c holds.
+ */
+__attribute__((target("avx,f16c")))
+void store_half_row_f16c(const float *src, uint16_t *dst, int count, float inv_scale) {
+    __m256 factor = _mm256_set1_ps(inv_scale);
+    __m256 largest = _mm256_set1_ps(DM_FLOAT16_MAX);
+    __m256 lowest = _mm256_set1_ps(-DM_FLOAT16_MAX);
+    __m256 infinity = _mm256_set1_ps(INFINITY);
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    int j = 0;
+    for(; j + 8 <= count; j += 8) {
+        __m256 values = _mm256_mul_ps(_mm256_loadu_ps(&src[j]), factor);
+        __m256 clamped = _mm256_min_ps(_mm256_max_ps(values, lowest), largest);
+        // infinities and NaNs are converted as they are
+        __m256 special = _mm256_cmp_ps(_mm256_andnot_ps(sign, values), infinity, _CMP_NLT_UQ);
+        __m128i halves = _mm256_cvtps_ph(_mm256_blendv_ps(clamped, values, special), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i*)&dst[j], halves);
+    }
+    for(; j < count; j++) {
+        dst[j] = float_to_half(src[j] * inv_scale);
+    }
+}
+
+bool cpu_has_f16c(void) {
+    static int supported = -1;
+    if(supported < 0) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+    }
+    return supported;
+}
+#endif
+
+/**
+ * Narrows count floats into row i of the matrix, starting at column start.
+ *
+ * @param dm A packed distance matrix
+ * @param i Row to write to
+ * @param start First column to write to
+ * @param count Number of cells to write
+ * @param src The values to store
+ */
+void store_row(packed_dm *dm, int i, int start, int count, const float *src) {
+    size_t offset = (size_t)i * dm->n_objects + start;
+
+    switch(dm->storage) {
+        case DM_FLOAT16: {
+            uint16_t *dst = (uint16_t*)dm->data + offset;
+            float inv_scale = 1 / dm->scale;
+#ifdef DM_F16C_KERNEL
+            if(cpu_has_f16c()) {
+                store_half_row_f16c(src, dst, count, inv_scale);
+                break;
+            }
+#endif
+            for(int j = 0; j < count; j++) {
+                dst[j] = float_to_half(src[j] * inv_scale);
+            }
+            break;
+        }
+        case DM_BFLOAT16: {
+            uint16_t *dst = (uint16_t*)dm->data + offset;
+            for(int j = 0; j < count; j++) {
+                dst[j] = float_to_bfloat16(src[j]);
+            }
+            break;
+        }
+        case DM_UINT16: {
+            uint16_t *dst = (uint16_t*)dm->data + offset;
+            float inv_scale = 1 / dm->scale;
+            for(int j = 0; j < count; j++) {
+                dst[j] = float_to_ucode(src[j] * inv_scale);
+            }
+            break;
+        }
+        default:
+            memcpy((float*)dm->data + offset, src, sizeof(float) * count);
+            break;
+    }
+}
+
+/**
+ * Widens row i of the matrix to float. Rows of DM_FLOAT32 matrices are returned in place, without copying.
+ *
+ * @param dm A packed distance matrix
+ * @param i Row to read
+ * @param buffer Scratch space with room for n_objects floats
+ * @return A pointer to the first position of the widened row
+ */
+const float *load_row(packed_dm *dm, int i, float *buffer) {
+    int n = dm->n_objects;
+    size_t offset = (size_t)i * n;
+
+    switch(dm->storage) {
+        case DM_FLOAT16: {
+            const uint16_t *src = (const uint16_t*)dm->data + offset;
+            float scale = dm->scale;
+#ifdef DM_F16C_KERNEL
+            if(cpu_has_f16c()) {
+                load_half_row_f16c(src, buffer, n, scale);
+                return buffer;
+            }
+#endif
+            for(int j = 0; j < n; j++) {
+                buffer[j] = half_to_float(src[j]) * scale;
+            }
+            return buffer;
+        }
+        case DM_BFLOAT16: {
+            const uint16_t *src = (const uint16_t*)dm->data + offset;
+            for(int j = 0; j < n; j++) {
+                buffer[j] = bfloat16_to_float(src[j]);
+            }
+            return buffer;
+        }
+        case DM_UINT16: {
+            const uint16_t *src = (const uint16_t*)dm->data + offset;
+            float scale = dm->scale;
+            for(int j = 0; j < n; j++) {
+                buffer[j] = ucode_to_float(src[j]) * scale;
+            }
+            return buffer;
+        }
+        default:
+            return (const float*)dm->data + offset;
+    }
+}
+
+/**
+ * Copies the lower triangle of the matrix onto its upper triangle.
+ *
+ * @param dm A packed distance matrix
+ */
+void mirror_lower(packed_dm *dm) {
+    int n = dm->n_objects;
+
+    if(dm->storage == DM_FLOAT32) {
+        float *cells = (float*)dm->data;
+        for(int i = 0; i < n; i++) {
+            for(int j = 0; j < i; j++) {
+                cells[(size_t)j * n + i] = cells[(size_t)i * n + j];
+            }
+        }
+    } else {
+        uint16_t *cells = (uint16_t*)dm->data;
+        for(int i = 0; i < n; i++) {
+            for(int j = 0; j < i; j++) {
+                cells[(size_t)j * n + i] = cells[(size_t)i * n + j];
+            }
+        }
+    }
+}
+
+#endif //CLUSTERING_PRECISION_H
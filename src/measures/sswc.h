@@ -16,42 +16,42 @@
  * @param dataset A pointer to the first position of the dataset.
  * @param n_objects Number of objects.
  * @param n_attributes Number of attributes.
+ * @param metric The distance metric between objects.
  * @return The Simplified Silhouette Width Criterion.
  */
-float sswc(int *medoids, float *dataset, int n_objects, int n_attributes) {
-    int n_medoids = 0;
-    for(int j = 0; j < n_objects; j++) {
-        n_medoids += medoids[j];
-    }
+float sswc(int *medoids, float *dataset, int n_objects, int n_attributes, dist_metric *metric) {
+    int n_medoids, *indices;
+    float *points = gather_medoids(medoids, dataset, n_objects, n_attributes, &indices, &n_medoids);
     if(n_medoids <= 1) {
+        free(indices);
+        free(points);
         return -1;  // the index for the trivial partition
     }
 
-    float dist, index = 0, a, b;
+    float *dists = (float*)malloc(sizeof(float) * n_medoids);
+    row_kernel distances = get_row_kernel(metric, n_attributes);
+
+    float index = 0, a, b;
 
     for(int i = 0; i < n_objects; i++) {
+        distances(&dataset[i * n_attributes], points, n_medoids, n_attributes, metric->weights, dists);
+
         a = INFINITY, b = INFINITY;
-        for(int j = 0; j < n_objects; j++) {
-            if(medoids[j] == 0) {
-                continue;
-            } else {
-                dist = get_euclidean_distance(
-                        &dataset[i * n_attributes],
-                        &dataset[j * n_attributes],
-                        n_attributes,
-                        false
-                );
-                if(dist < a) {
-                    b = a;
-                    a = dist;
-                }
-                else if (dist < b) {
-                    b = dist;
-                }
+        for(int j = 0; j < n_medoids; j++) {
+            if(dists[j] < a) {
+                b = a;
+                a = dists[j];
+            }
+            else if (dists[j] < b) {
+                b = dists[j];
             }
         }
         index += (b - a) / ((b - a > 0)*fmaxf(b, a) + (b - a <= 0)*1);
     }
+
+    free(dists);
+    free(indices);
+    free(points);
     return index / n_objects;
 }
 
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/utils.h"
+#include "../src/measures/commons.h"
+#include "../src/measures/dbcv.h"
+
+/**
+ * Largest tolerated error of each storage format against DM_FLOAT32: relative for the weight of the minimum spanning
+ * tree, absolute for the DBCV index.
+ */
+const float mst_tolerance[] = {0, 1e-3f, 1e-2f, 1e-3f};
+const float dbcv_tolerance[] = {0, 1e-3f, 1e-2f, 1e-3f};
+
+const char *storage_names[] = {"float32", "float16", "bfloat16", "uint16"};
+
+float mst_weight(packed_dm *dm, int n_objects) {
+    srand(0);  // same starting vertex for every format
+    float *mst = prim_mat(dm, n_objects);
+    float weight = 0;
+    for(int n = 0; n < n_objects; n++) {
+        if(mst[n * MST_FIELDS + NEIGHBOR_DISTANCE] != INFINITY) {
+            weight += mst[n * MST_FIELDS + NEIGHBOR_DISTANCE];
+        }
+    }
+    free(mst);
+    return weight;
+}
+
+/**
+ * Compares the MST weight and the DBCV index obtained with each storage format against the ones obtained with
+ * single precision, over a matrix of squared euclidean distances.
+ *
+ * @return Number of formats out of tolerance
+ */
+int check_storage(const char *name, float *dataset, int *partition, int n_objects, int n_attributes) {
+    dist_metric metric = get_metric(METRIC_SQEUCLIDEAN, dataset, n_objects, n_attributes);
+    float float_weight = 0, float_index = 0;
+    int failures = 0;
+
+    for(int storage = DM_FLOAT32; storage <= DM_UINT16; storage++) {
+        packed_dm dm = get_packed_distance_matrix(dataset, n_objects, n_attributes, &metric, storage);
+        float weight = mst_weight(&dm, n_objects);
+        float index = dbcv(partition, &dm, n_objects, n_attributes);
+        free_packed_dm(&dm);
+
+        if(storage == DM_FLOAT32) {
+            float_weight = weight;
+            float_index = index;
+        }
+        float weight_error = fabsf(weight - float_weight) / float_weight;
+        float index_error = fabsf(index - float_index);
+        bool passed = isfinite(index) && (weight_error <= mst_tolerance[storage]) &&
+                      (index_error <= dbcv_tolerance[storage]);
+
+        printf(
+            "%s %s: mst weight %f (rel. error %e), dbcv %f (abs. error %e) %s\n",
+            name, storage_names[storage], weight, weight_error, index, index_error, passed ? "ok" : "FAILED"
+        );
+        failures += !passed;
+    }
+
+    free_metric(&metric);
+    return failures;
+}
+
+int check_iris(char *path) {
+    int n_objects, n_attributes;
+    float *dataset = read_dataset(path, &n_objects, &n_attributes);
+
+    int *partition = (int*)malloc(sizeof(int) * n_objects);
+    for(int i = 0; i < n_objects; i++) {
+        partition[i] = (i / 50) % 3;
+    }
+
+    int failures = check_storage("iris", dataset, partition, n_objects, n_attributes);
+
+    free(partition);
+    free(dataset);
+    return failures;
+}
+
+/**
+ * Three chains of five objects on a line, whose gaps grow tenfold from 1 to 1000, lying 1200 apart. Squared distances
+ * span from 1 to above 1e7, and the three middle objects of each chain are inner nodes of its minimum spanning tree,
+ * so that the DBCV index depends on the stored distances.
+ */
+int check_chains() {
+    const float offsets[] = {0, 1, 11, 111, 1111};
+    const float origin[] = {0, 1200, 2400};
+    float dataset[15 * 2];
+    int partition[15];
+
+    for(int i = 0; i < 15; i++) {
+        dataset[i * 2] = origin[i / 5] + offsets[i % 5];
+        dataset[i * 2 + 1] = 0;
+        partition[i] = i / 5;
+    }
+
+    return check_storage("chains", dataset, partition, 15, 2);
+}
+
+/**
+ * Three 7 x 7 grids with spacings of 1, 10 and 100, lying up to 20000 apart. Squared distances span more than
+ * eight orders of magnitude.
+ */
+int check_grids() {
+    const int side = 7, n_groups = 3, n_objects = side * side * n_groups;
+    const float spacing[] = {1, 10, 100};
+    const float origin[][2] = {{0, 0}, {1000, 0}, {0, 20000}};
+
+    float *dataset = (float*)malloc(sizeof(float) * n_objects * 2);
+    int *partition = (int*)malloc(sizeof(int) * n_objects);
+
+    for(int i = 0; i < n_objects; i++) {
+        int c = i / (side * side), k = i % (side * side);
+        dataset[i * 2] = origin[c][0] + spacing[c] * (k % side);
+        dataset[i * 2 + 1] = origin[c][1] + spacing[c] * (k / side);
+        partition[i] = c;
+    }
+
+    int failures = check_storage("grids", dataset, partition, n_objects, 2);
+
+    free(partition);
+    free(dataset);
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        printf("usage: %s <path to iris.csv>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int failures = check_iris(argv[1]) + check_chains() + check_grids();
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}